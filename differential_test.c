@@ -0,0 +1,358 @@
+/*-------------------------------------------
+Differential Test of the Student Lists
+Build: gcc -g -O1 -pthread -fsanitize=address,undefined -DCHECK_INVARIANTS -o differential_test differential_test.c
+Run:   ./differential_test [operations] [seed]
+------------------------------------------- */
+
+#define STUDENT_DATABASE_NO_MAIN
+#include "main.c"
+
+#define MAX_REFERENCE_STUDENTS 64
+
+// a student as the reference model sees it, independent of how the database stores them
+typedef struct {
+	char name[32];
+	char id[MAX_ID_LENGTH + 1];
+	double gpa;
+	int creditHours;
+} ReferenceStudent;
+
+// the reference model keeps students in a plain array in the order they were added
+ReferenceStudent reference[MAX_REFERENCE_STUDENTS];
+int referenceCount = 0;
+
+// the cache as the model sees it: which lists have output saved, how big it is and when it was last used
+typedef struct {
+	bool cached;
+	bool stale;              // the list changed since its output was saved
+	size_t length;
+	unsigned long lastUse;
+} ReferenceCacheEntry;
+
+ReferenceCacheEntry referenceCache[LIST_COUNT];
+size_t referenceCacheBytes = 0;
+size_t referenceCacheBudget = DEFAULT_CACHE_BUDGET;
+unsigned long referenceHits = 0;
+unsigned long referenceMisses = 0;
+unsigned long referenceClock = 0;
+
+uint64_t randomState;
+
+// xorshift, so a seed always gives the same sequence of operations
+uint32_t nextRandom() {
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 7;
+    randomState ^= randomState << 17;
+    return (uint32_t) (randomState >> 32);
+}
+
+// small pools of values so that names, IDs, GPAs and credit hours collide and hit every boundary
+void randomStudent(ReferenceStudent* student) {
+    const char* firstNames[] = {"An", "Ann", "Anna", "Bo", "Bob", "Zoe"};
+    const char* lastNames[] = {"Li", "Lim", "Smith", "Smith Jr", "O"};
+    const char* idChars = "09AZ";
+    const double gpas[] = {0.0, 1.5, 1.99, 2.0, 3.0, 3.49, 3.5, 4.0};
+    const int creditHours[] = {-1, 0, 29, 30, 59, 60, 89, 90, 120};
+
+    const char* first = firstNames[nextRandom() % 6];
+    if (nextRandom() % 8 == 0) {
+        snprintf(student->name, sizeof(student->name), "%s", first);
+    }
+    else {
+        snprintf(student->name, sizeof(student->name), "%s %s", first, lastNames[nextRandom() % 5]);
+    }
+
+    int idLength = 1 + nextRandom() % 3;
+    for (int i = 0; i < idLength; i++) {
+        student->id[i] = idChars[nextRandom() % 4];
+    }
+    student->id[idLength] = '\0';
+
+    student->gpa = gpas[nextRandom() % 8];
+    student->creditHours = creditHours[nextRandom() % 9];
+}
+
+// the list rules, written out again so the model doesn't share code with the database
+bool referenceBelongsInList(ReferenceStudent* student, ListIndex list) {
+    switch (list) {
+        case HONOR_ROLL_LIST:
+            return student->gpa >= 3.5;
+        case ACADEMIC_PROBATION_LIST:
+            return student->gpa < 2.0;
+        case FRESHMAN_LIST:
+            return student->creditHours < 30;
+        case SOPHOMORE_LIST:
+            return student->creditHours >= 30 && student->creditHours < 60;
+        case JUNIOR_LIST:
+            return student->creditHours >= 60 && student->creditHours < 90;
+        case SENIOR_LIST:
+            return student->creditHours >= 90;
+        default:
+            return true;
+    }
+}
+
+int referenceCompare(ReferenceStudent* a, ReferenceStudent* b, ListIndex list) {
+    switch (list) {
+        case ID_LIST:
+            return strcmp(a->id, b->id);
+        case HONOR_ROLL_LIST:
+        case ACADEMIC_PROBATION_LIST:
+            return (a->gpa > b->gpa) - (a->gpa < b->gpa);
+        default:
+            return strcmp(a->name, b->name);
+    }
+}
+
+// order qsort uses in compareReferenceIndexes
+ListIndex sortingList;
+
+// orders reference students by the list's key, then by when they were added, like sortedInsert does
+int compareReferenceIndexes(const void* a, const void* b) {
+    int i = *(const int*) a;
+    int j = *(const int*) b;
+    int result = referenceCompare(&reference[i], &reference[j], sortingList);
+    return result != 0 ? result : i - j;
+}
+
+void testFailed(long operation, const char* message, int list) {
+    fprintf(stderr, "Error: operation %ld, list %d: %s\n", operation, list, message);
+    exit(1);
+}
+
+// checks every list of the database against the model, in order and field by field
+void compareWithReference(Database* db, long operation) {
+    StudentNode* lists[LIST_COUNT] = {
+        db->pIDList, db->pHonorRollList, db->pAcademicProbationList,
+        db->pFreshmanList, db->pSophomoreList, db->pJuniorList, db->pSeniorList
+    };
+
+    // the lists only use three orders, so sort the model once for each
+    int byID[MAX_REFERENCE_STUDENTS];
+    int byGPA[MAX_REFERENCE_STUDENTS];
+    int byName[MAX_REFERENCE_STUDENTS];
+    for (int i = 0; i < referenceCount; i++) {
+        byID[i] = byGPA[i] = byName[i] = i;
+    }
+    sortingList = ID_LIST;
+    qsort(byID, referenceCount, sizeof(int), compareReferenceIndexes);
+    sortingList = HONOR_ROLL_LIST;
+    qsort(byGPA, referenceCount, sizeof(int), compareReferenceIndexes);
+    sortingList = FRESHMAN_LIST;
+    qsort(byName, referenceCount, sizeof(int), compareReferenceIndexes);
+
+    for (int list = 0; list < LIST_COUNT; list++) {
+        // expected contents: the members of the list, in its order
+        int* order = list == ID_LIST ? byID : (list == HONOR_ROLL_LIST || list == ACADEMIC_PROBATION_LIST ? byGPA : byName);
+        ReferenceStudent* expected[MAX_REFERENCE_STUDENTS];
+        int count = 0;
+        for (int i = 0; i < referenceCount; i++) {
+            if (referenceBelongsInList(&reference[order[i]], list)) {
+                expected[count++] = &reference[order[i]];
+            }
+        }
+
+        StudentNode* current = lists[list];
+        for (int i = 0; i < count; i++, current = nextNode(current)) {
+            if (current == NULL) {
+                testFailed(operation, "list is missing students", list);
+            }
+
+            char name[NAME_BUFFER_LENGTH];
+            char id[MAX_ID_LENGTH + 1];
+            Student* student = nodeStudent(current);
+            if (strcmp(studentName(student, name, sizeof(name)), expected[i]->name) != 0 ||
+                strcmp(studentID(student, id), expected[i]->id) != 0 ||
+                student->gpa != expected[i]->gpa ||
+                student->creditHours != expected[i]->creditHours) {
+                testFailed(operation, "list differs from the reference", list);
+            }
+        }
+        if (current != NULL) {
+            testFailed(operation, "list has extra students", list);
+        }
+    }
+
+    if (db->studentCount != referenceCount) {
+        testFailed(operation, "student store has the wrong size", ID_LIST);
+    }
+}
+
+// marks the saved output of every list the student is in as stale
+void referenceListsChanged(ReferenceStudent* student) {
+    for (int list = 0; list < LIST_COUNT; list++) {
+        if (referenceBelongsInList(student, list)) {
+            referenceCache[list].stale = true;
+        }
+    }
+}
+
+// drops the least recently used saved output, stale or not
+void referenceEvict() {
+    int oldest = -1;
+    for (int list = 0; list < LIST_COUNT; list++) {
+        if (referenceCache[list].cached && (oldest < 0 || referenceCache[list].lastUse < referenceCache[oldest].lastUse)) {
+            oldest = list;
+        }
+    }
+    referenceCache[oldest].cached = false;
+    referenceCacheBytes -= referenceCache[oldest].length;
+}
+
+// what displayList should do with a list whose fresh output is length bytes long
+void referenceDisplay(ListIndex list, size_t length) {
+    ReferenceCacheEntry* entry = &referenceCache[list];
+    referenceClock++;
+
+    if (entry->cached && !entry->stale) {
+        referenceHits++;
+        entry->lastUse = referenceClock;
+        return;
+    }
+    referenceMisses++;
+
+    if (entry->cached) {
+        entry->cached = false;
+        referenceCacheBytes -= entry->length;
+    }
+    if (length > referenceCacheBudget) {
+        return;
+    }
+    while (referenceCacheBytes + length > referenceCacheBudget) {
+        referenceEvict();
+    }
+    entry->cached = true;
+    entry->stale = false;
+    entry->length = length;
+    entry->lastUse = referenceClock;
+    referenceCacheBytes += length;
+}
+
+void referenceSetBudget(size_t bytes) {
+    referenceCacheBudget = bytes;
+    while (referenceCacheBytes > referenceCacheBudget) {
+        referenceEvict();
+    }
+}
+
+// runs displayList with stdout captured, returning what it printed (the caller frees it)
+char* captureDisplayList(Database* db, ListIndex list, size_t* length) {
+    char* output = NULL;
+    FILE* capture = open_memstream(&output, length);
+    if (capture == NULL) {
+        fprintf(stderr, "Error: Unable to capture output.\n");
+        exit(1);
+    }
+
+    FILE* realStdout = stdout;
+    stdout = capture;
+    displayList(db, list);
+    stdout = realStdout;
+    fclose(capture);
+    return output;
+}
+
+// displays a list through the cache and checks the output against a fresh render and the model
+void checkCachedDisplay(Database* db, ListIndex list, long operation) {
+    size_t displayedLength;
+    char* displayed = captureDisplayList(db, list, &displayedLength);
+
+    char* fresh = NULL;
+    size_t freshLength;
+    FILE* out = open_memstream(&fresh, &freshLength);
+    if (out == NULL) {
+        fprintf(stderr, "Error: Unable to capture output.\n");
+        exit(1);
+    }
+    renderList(out, db, list);
+    fclose(out);
+
+    if (displayedLength != freshLength || memcmp(displayed, fresh, freshLength) != 0) {
+        testFailed(operation, "cached output differs from a fresh render", list);
+    }
+    free(displayed);
+    free(fresh);
+
+    referenceDisplay(list, freshLength);
+    QueryCache* cache = &db->cache;
+    if (cache->hits != referenceHits || cache->misses != referenceMisses) {
+        testFailed(operation, "cache hits or misses differ from the reference", list);
+    }
+    if (cache->bytesUsed != referenceCacheBytes) {
+        testFailed(operation, "cache size differs from the reference", list);
+    }
+    for (int i = 0; i < LIST_COUNT; i++) {
+        if ((cache->entries[i] != NULL) != referenceCache[i].cached) {
+            testFailed(operation, "cache holds different lists than the reference", i);
+        }
+    }
+}
+
+// deletes like deleteStudent does: the first student with the ID in ID list order, which is the earliest added
+void referenceDelete(const char* id) {
+    for (int i = 0; i < referenceCount; i++) {
+        if (strcmp(reference[i].id, id) == 0) {
+            referenceListsChanged(&reference[i]);
+            memmove(&reference[i], &reference[i + 1], (referenceCount - i - 1) * sizeof(ReferenceStudent));
+            referenceCount--;
+            return;
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    long operations = argc > 1 ? atol(argv[1]) : 1000000;
+    unsigned long seed = argc > 2 ? strtoul(argv[2], NULL, 10) : 1;
+    randomState = seed * 2654435761u + 88172645463325252ULL;
+
+    // deleteStudent reports unknown IDs on stdout
+    freopen("/dev/null", "w", stdout);
+
+    Database* db = initDatabase();
+    for (long operation = 0; operation < operations; operation++) {
+        uint32_t choice = nextRandom() % 8;
+
+        if (choice < 4 && referenceCount < MAX_REFERENCE_STUDENTS) {
+            ReferenceStudent student;
+            randomStudent(&student);
+            reference[referenceCount++] = student;
+            referenceListsChanged(&student);
+            addStudent(db, createStudent(student.name, student.id, student.gpa, student.creditHours));
+        }
+        else if (choice < 7 && referenceCount > 0) {
+            char id[MAX_ID_LENGTH + 1];
+            strcpy(id, reference[nextRandom() % referenceCount].id);
+            referenceDelete(id);
+            deleteStudent(db, id);
+        }
+        else {
+            // IDs nobody has, including ones compact mode can't pack
+            char* id = nextRandom() % 2 == 0 ? "ZZZZ" : "not-an-id";
+            deleteStudent(db, id);
+        }
+
+        compareWithReference(db, operation);
+
+        // now and then pick a new budget, small ones so that lists get evicted
+        if (nextRandom() % 64 == 0) {
+            const size_t budgets[] = {0, 100, 400, 1500, 4000, DEFAULT_CACHE_BUDGET};
+            size_t budget = budgets[nextRandom() % 6];
+            referenceSetBudget(budget);
+            setCacheBudget(db, budget);
+        }
+
+        // display a few lists, often the same one twice so unchanged output is reused
+        int displays = 1 + nextRandom() % 3;
+        for (int i = 0; i < displays; i++) {
+            checkCachedDisplay(db, nextRandom() % LIST_COUNT, operation);
+        }
+    }
+
+    freeDatabase(db);
+#ifdef COMPACT_STUDENTS
+    freeCompactStorage();
+#endif
+    fprintf(stderr, "%ld operations matched the reference (seed %lu), cache hits %lu, misses %lu\n",
+            operations, seed, referenceHits, referenceMisses);
+    return 0;
+}
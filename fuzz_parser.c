@@ -0,0 +1,113 @@
+/*------------------------------------------- 
+CSV Loader Fuzz Harness
+libFuzzer: clang -g -O1 -pthread -fsanitize=fuzzer,address,undefined -DLIBFUZZER -DCHECK_INVARIANTS -o fuzz_parser fuzz_parser.c
+AFL:       afl-clang-fast -g -pthread -fsanitize=address,undefined -DCHECK_INVARIANTS -o fuzz_parser fuzz_parser.c
+Replay:    gcc -g -pthread -fsanitize=address,undefined -DCHECK_INVARIANTS -o fuzz_parser fuzz_parser.c
+           ./fuzz_parser [files...]   (reads stdin if no files are given)
+------------------------------------------- */
+
+#define STUDENT_DATABASE_NO_MAIN
+#include "main.c"
+
+// parses every line of the input on its own, then loads the whole input as a file into a fresh database
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    static bool quiet = false;
+    if (!quiet) {
+        // the loader reports every bad line on stdout
+        freopen("/dev/null", "w", stdout);
+        quiet = true;
+    }
+
+    char* text = (char*) malloc(size + 1);
+    if (text == NULL) {
+        return 0;
+    }
+    memcpy(text, data, size);
+    text[size] = '\0';
+
+    // parseStudentLine gets each line the way readStudentsFromFile would, newline included
+    char* line = text;
+    while (*line != '\0') {
+        char* end = strchr(line, '\n');
+        char saved = '\0';
+        if (end != NULL) {
+            saved = end[1];
+            end[1] = '\0';
+        }
+
+        Student* student = parseStudentLine(line, 2);
+        if (student != NULL) {
+            freeStudent(student);
+        }
+
+        if (end == NULL) {
+            break;
+        }
+        end[1] = saved;
+        line = end + 1;
+    }
+
+    // the loader sees the original bytes, including any embedded NULs
+    memcpy(text, data, size);
+    FILE* file = fmemopen(text, size, "r");
+    if (file != NULL) {
+        Database* db = initDatabase();
+        readStudentsFromStream(db, file);
+        fclose(file);
+        freeDatabase(db);
+    }
+#ifdef COMPACT_STUDENTS
+    // the name tables and arenas outlive the database, so reset them or they grow with every input
+    freeCompactStorage();
+#endif
+
+    free(text);
+    return 0;
+}
+
+#ifndef LIBFUZZER
+// runs one input from file (or stdin if file is NULL), for AFL and for replaying crashes
+int runInput(const char* filename) {
+    FILE* file = filename != NULL ? fopen(filename, "rb") : stdin;
+    if (file == NULL) {
+        fprintf(stderr, "Error: Unable to open file %s.\n", filename);
+        return 1;
+    }
+
+    size_t size = 0;
+    size_t capacity = 4096;
+    uint8_t* data = (uint8_t*) malloc(capacity);
+    size_t read;
+    while (data != NULL && (read = fread(data + size, 1, capacity - size, file)) > 0) {
+        size += read;
+        if (size == capacity) {
+            capacity *= 2;
+            data = (uint8_t*) realloc(data, capacity);
+        }
+    }
+    if (file != stdin) {
+        fclose(file);
+    }
+    if (data == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed.\n");
+        return 1;
+    }
+
+    LLVMFuzzerTestOneInput(data, size);
+    free(data);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        return runInput(NULL);
+    }
+
+    for (int i = 1; i < argc; i++) {
+        if (runInput(argv[i]) != 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+#endif
@@ -9,7 +9,50 @@ Author: Nuha Abougoash
 #include <string.h>
 #include <ctype.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <limits.h>
+#include <math.h>
+
+// compile with -DPARALLEL_QUERIES to keep a store of every student that runQuery scans on a thread pool
+#ifdef PARALLEL_QUERIES
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+// compile with -DCOMPACT_STUDENTS to pack IDs into integers and intern first/last names
+#ifdef COMPACT_STUDENTS
+typedef struct {
+	uint64_t id;          // ID packed 6 bits per character, see encodeID
+	uint32_t firstName;   // index into the interned first name table
+	uint32_t lastName;    // index into the interned last name table, NO_LAST_NAME if none
+	double gpa;
+	int creditHours;
+} Student;
 
+// key used to look a student up by ID
+typedef uint64_t StudentKey;
+
+// table of unique strings, each identified by its index
+typedef struct {
+	char** strings;
+	uint32_t count;
+	uint32_t capacity;
+	uint32_t* buckets;    // open addressing hash of index + 1, 0 marks an empty slot
+	uint32_t bucketCount;
+} NameTable;
+
+// hands out fixed-size slots from large blocks, so records don't each pay for a malloc header
+// a slot can also be named by a 32-bit index, 0 meaning none (slot 0 of each block is never handed out)
+typedef struct {
+	size_t slotSize;      // a power of two
+	char** blocks;
+	uint32_t blockCount;
+	uint32_t blockCapacity;
+	uint32_t slotsUsed;   // slots used in the newest block
+	void* freeSlots;      // released slots, linked through their first bytes
+} Arena;
+#else
 typedef struct {
 	char* name;
 	char* id;
@@ -17,10 +60,53 @@ typedef struct {
 	int creditHours;
 } Student;
 
+typedef const char* StudentKey;
+#endif
+
+#ifdef COMPACT_STUDENTS
+// links are 32-bit arena indices instead of pointers, see nodeStudent and nextNode
+typedef struct StudentNode {
+	uint32_t student;
+	uint32_t next;        // 0 at the end of the list
+} StudentNode;
+#else
 typedef struct StudentNode{
 	Student* pStudent;
 	struct StudentNode* pNext;
 } StudentNode;
+#endif
+
+// lists kept by the database, used to version them and to key cached output
+typedef enum {
+	ID_LIST,
+	HONOR_ROLL_LIST,
+	ACADEMIC_PROBATION_LIST,
+	FRESHMAN_LIST,
+	SOPHOMORE_LIST,
+	JUNIOR_LIST,
+	SENIOR_LIST,
+	LIST_COUNT
+} ListIndex;
+
+// rendered output of displaying one list, kept in least recently used order
+typedef struct CacheEntry {
+	ListIndex list;
+	unsigned long version;   // version of the list the output was rendered from
+	char* output;
+	size_t length;
+	struct CacheEntry* pPrev;
+	struct CacheEntry* pNext;
+} CacheEntry;
+
+typedef struct {
+	CacheEntry* entries[LIST_COUNT];
+	CacheEntry* pMostRecent;
+	CacheEntry* pLeastRecent;
+	size_t bytesUsed;
+	size_t byteBudget;
+	unsigned long hits;
+	unsigned long misses;
+} QueryCache;
 
 typedef struct {
 	StudentNode* pIDList;
@@ -30,23 +116,66 @@ typedef struct {
 	StudentNode* pSophomoreList;
 	StudentNode* pJuniorList;
 	StudentNode* pSeniorList;
+#ifdef PARALLEL_QUERIES
+	Student** pStudents;     // every student in insertion order, scanned by runQuery
+	int studentCapacity;
+#endif
+	int studentCount;
+	unsigned long listVersions[LIST_COUNT];  // bumped whenever a list changes
+	QueryCache cache;
 } Database;
 
 typedef int (*CompareFunc)(Student*, Student*);
+typedef bool (*StudentPredicate)(Student*, void*);
+
+#ifdef PARALLEL_QUERIES
+typedef struct {
+	Student* student;
+	int position;            // index in the student store, breaks ties in insertion order
+} QueryMatch;
+
+typedef struct {
+	QueryMatch* matches;
+	int count;
+	double gpaTotal;
+} QueryResult;
+#endif
 
 Database* initDatabase();
 void addStudent(Database* db, Student* student);
 Student* createStudent(char* name, char* id, double gpa, int creditHours);
 void readStudentsFromFile(Database* db, char* filename);
+void readStudentsFromStream(Database* db, FILE* file);
+Student* parseStudentLine(char* line, int lineNumber);
 void deleteStudent(Database* db, char* id);
+void freeStudent(Student* student);
 void freeDatabase(Database* db);
+#ifdef COMPACT_STUDENTS
+void freeCompactStorage();
+#endif
 StudentNode* createStudentNode(Student* student);
+Student* nodeStudent(StudentNode* node);
+StudentNode* nextNode(StudentNode* node);
+void setNextNode(StudentNode* node, StudentNode* next);
+void freeStudentNode(StudentNode* node);
 StudentNode* sortedInsert(StudentNode* head, StudentNode* newNode, int (*compare)(Student*, Student*));
 int compareByID(Student* a, Student* b);
 int compareByGPA(Student* a, Student* b);
 int compareByName(Student* a, Student* b);
 StudentNode* findAndRemove(StudentNode** pHead, char* id);
-void displayStudent(StudentNode* studentNode);
+#ifdef PARALLEL_QUERIES
+QueryResult runQuery(Database* db, StudentPredicate predicate, void* arg, CompareFunc order);
+void freeQueryResult(QueryResult* result);
+void stopQueryThreads();
+#endif
+const char* studentName(Student* student, char* buffer, size_t size);
+const char* studentID(Student* student, char* buffer);
+bool makeStudentKey(const char* id, StudentKey* key);
+bool studentHasKey(Student* student, StudentKey key);
+void printStudent(FILE* out, Student* student);
+void displayStudent(Student* student);
+void setCacheBudget(Database* db, size_t bytes);
+void freeQueryCache(QueryCache* cache);
 void displayMenuAndExecute(Database* db);
 void displayHead(Database* db);
 void displayHonorRoll(Database* db);
@@ -58,10 +187,15 @@ void displaySeniors(Database* db);
 void displayStudentByID(Database* db);
 void addStudentFromFile(Database* db, Student* student);
 Student* createStudentFromInput();
-void deleteIDList(StudentNode** studentList, const char* id);
+bool deleteIDList(StudentNode** studentList, Student* student);
+#ifdef CHECK_INVARIANTS
+void checkDatabaseInvariants(Database* db);
+#endif
 
 #define MAX_ID_LENGTH 10
 #define MAX_NAME_LENGTH 100
+#define NAME_BUFFER_LENGTH 256
+#define DEFAULT_CACHE_BUDGET (1 << 20)
 
 // initializes a new empty database and returns pointer to it
 Database* initDatabase() {
@@ -82,11 +216,319 @@ Database* initDatabase() {
     db->pSophomoreList = NULL;
     db->pJuniorList = NULL;
     db->pSeniorList = NULL;
+#ifdef PARALLEL_QUERIES
+    db->pStudents = NULL;
+    db->studentCapacity = 0;
+#endif
+    db->studentCount = 0;
+
+    // start with every list at version 0 and an empty output cache
+    memset(db->listVersions, 0, sizeof(db->listVersions));
+    memset(&db->cache, 0, sizeof(QueryCache));
+    db->cache.byteBudget = DEFAULT_CACHE_BUDGET;
 
     // return pointer to new database
     return db;
 }
 
+#ifdef COMPACT_STUDENTS
+#define ID_BITS_PER_CHAR 6
+#define NO_LAST_NAME UINT32_MAX
+
+// shared by every database, so freeDatabase leaves them alone (see freeCompactStorage)
+NameTable firstNames = {0};
+NameTable lastNames = {0};
+
+#define ARENA_BLOCK_SLOTS 1024
+
+// ASan can't see into the arenas, so under it unused slots are poisoned and any access to them is reported
+// (gcc defines __SANITIZE_ADDRESS__, clang answers __has_feature)
+#if defined(__SANITIZE_ADDRESS__)
+#define ARENA_POISONING
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define ARENA_POISONING
+#endif
+#endif
+
+#ifdef ARENA_POISONING
+#include <sanitizer/asan_interface.h>
+#define POISON_SLOTS(start, size) ASAN_POISON_MEMORY_REGION(start, size)
+#define UNPOISON_SLOTS(start, size) ASAN_UNPOISON_MEMORY_REGION(start, size)
+#else
+#define POISON_SLOTS(start, size) ((void) (start), (void) (size))
+#define UNPOISON_SLOTS(start, size) ((void) (start), (void) (size))
+#endif
+
+_Static_assert((sizeof(Student) & (sizeof(Student) - 1)) == 0, "arena slots must be a power of two");
+_Static_assert((sizeof(StudentNode) & (sizeof(StudentNode) - 1)) == 0, "arena slots must be a power of two");
+
+Arena studentArena = {sizeof(Student), NULL, 0, 0, 0, NULL};
+Arena nodeArena = {sizeof(StudentNode), NULL, 0, 0, 0, NULL};
+
+// returns an unused slot of the arena's size
+void* arenaAlloc(Arena* arena) {
+    if (arena->freeSlots != NULL) {
+        void* slot = arena->freeSlots;
+        UNPOISON_SLOTS(slot, arena->slotSize);
+        arena->freeSlots = *(void**) slot;
+        return slot;
+    }
+
+    if (arena->blockCount == 0 || arena->slotsUsed == ARENA_BLOCK_SLOTS) {
+        if (arena->blockCount == arena->blockCapacity) {
+            arena->blockCapacity = arena->blockCapacity == 0 ? 16 : arena->blockCapacity * 2;
+            arena->blocks = (char**) realloc(arena->blocks, arena->blockCapacity * sizeof(char*));
+        }
+
+        // blocks are aligned to their size, so a slot's block can be found from its address
+        size_t blockSize = ARENA_BLOCK_SLOTS * arena->slotSize;
+        char* block = (char*) aligned_alloc(blockSize, blockSize);
+        if (arena->blocks == NULL || block == NULL) {
+            printf("Error: Memory allocation failed.\n");
+            exit(1);
+        }
+
+        // slot 0 holds the block's number instead of a record
+        *(uint32_t*) block = arena->blockCount;
+        POISON_SLOTS(block + arena->slotSize, blockSize - arena->slotSize);
+        arena->blocks[arena->blockCount++] = block;
+        arena->slotsUsed = 1;
+    }
+
+    char* slot = arena->blocks[arena->blockCount - 1] + arena->slotsUsed++ * arena->slotSize;
+    UNPOISON_SLOTS(slot, arena->slotSize);
+    return slot;
+}
+
+// gives a slot back to the arena for reuse
+void arenaFree(Arena* arena, void* slot) {
+    *(void**) slot = arena->freeSlots;
+    arena->freeSlots = slot;
+    POISON_SLOTS(slot, arena->slotSize);
+}
+
+// returns the index of a slot, or 0 for NULL
+uint32_t arenaIndex(Arena* arena, void* slot) {
+    if (slot == NULL) {
+        return 0;
+    }
+
+    size_t blockSize = ARENA_BLOCK_SLOTS * arena->slotSize;
+    char* block = (char*) ((uintptr_t) slot & ~(uintptr_t) (blockSize - 1));
+    return *(uint32_t*) block * ARENA_BLOCK_SLOTS + (uint32_t) (((char*) slot - block) / arena->slotSize);
+}
+
+// returns the slot with the given index, or NULL for 0
+void* arenaSlot(Arena* arena, uint32_t index) {
+    if (index == 0) {
+        return NULL;
+    }
+    return arena->blocks[index / ARENA_BLOCK_SLOTS] + (index % ARENA_BLOCK_SLOTS) * arena->slotSize;
+}
+
+// frees every block of the arena, invalidating all slots
+void freeArena(Arena* arena) {
+    for (uint32_t i = 0; i < arena->blockCount; i++) {
+        UNPOISON_SLOTS(arena->blocks[i], ARENA_BLOCK_SLOTS * arena->slotSize);
+        free(arena->blocks[i]);
+    }
+    free(arena->blocks);
+    arena->blocks = NULL;
+    arena->blockCount = 0;
+    arena->blockCapacity = 0;
+    arena->slotsUsed = 0;
+    arena->freeSlots = NULL;
+}
+
+// packs an ID of up to MAX_ID_LENGTH digits/uppercase letters into an integer
+// each character takes 6 bits (0 marks the end of the ID), so comparing the
+// packed values gives the same order as strcmp on the original strings
+bool encodeID(const char* id, uint64_t* packed) {
+    uint64_t value = 0;
+    size_t length = strlen(id);
+
+    if (length > MAX_ID_LENGTH) {
+        return false;
+    }
+
+    for (size_t i = 0; i < MAX_ID_LENGTH; i++) {
+        uint64_t code = 0;
+        if (i < length) {
+            if (id[i] >= '0' && id[i] <= '9') {
+                code = id[i] - '0' + 1;
+            }
+            else if (id[i] >= 'A' && id[i] <= 'Z') {
+                code = id[i] - 'A' + 11;
+            }
+            else {
+                return false;
+            }
+        }
+        value = (value << ID_BITS_PER_CHAR) | code;
+    }
+
+    *packed = value;
+    return true;
+}
+
+// turns a packed ID back into a string, buffer must hold MAX_ID_LENGTH + 1 chars
+void decodeID(uint64_t packed, char* buffer) {
+    int length = 0;
+
+    for (int i = MAX_ID_LENGTH - 1; i >= 0; i--) {
+        int code = (packed >> (i * ID_BITS_PER_CHAR)) & ((1 << ID_BITS_PER_CHAR) - 1);
+        if (code == 0) {
+            break;
+        }
+        buffer[length++] = code <= 10 ? '0' + code - 1 : 'A' + code - 11;
+    }
+    buffer[length] = '\0';
+}
+
+// FNV-1a hash of the first length chars of name
+uint32_t hashName(const char* name, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char) name[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// doubles the hash table of a name table and rehashes every string into it
+void growNameBuckets(NameTable* table) {
+    uint32_t bucketCount = table->bucketCount == 0 ? 64 : table->bucketCount * 2;
+    uint32_t* buckets = (uint32_t*) calloc(bucketCount, sizeof(uint32_t));
+    if (buckets == NULL) {
+        printf("Error: Memory allocation failed.\n");
+        exit(1);
+    }
+
+    for (uint32_t i = 0; i < table->count; i++) {
+        const char* name = table->strings[i];
+        uint32_t slot = hashName(name, strlen(name)) & (bucketCount - 1);
+        while (buckets[slot] != 0) {
+            slot = (slot + 1) & (bucketCount - 1);
+        }
+        buckets[slot] = i + 1;
+    }
+
+    free(table->buckets);
+    table->buckets = buckets;
+    table->bucketCount = bucketCount;
+}
+
+// returns the index of the first length chars of name in the table, adding them if new
+uint32_t internName(NameTable* table, const char* name, size_t length) {
+    // keep the hash table at most half full
+    if ((table->count + 1) * 2 > table->bucketCount) {
+        growNameBuckets(table);
+    }
+
+    uint32_t slot = hashName(name, length) & (table->bucketCount - 1);
+    while (table->buckets[slot] != 0) {
+        const char* existing = table->strings[table->buckets[slot] - 1];
+        if (strncmp(existing, name, length) == 0 && existing[length] == '\0') {
+            return table->buckets[slot] - 1;
+        }
+        slot = (slot + 1) & (table->bucketCount - 1);
+    }
+
+    if (table->count == table->capacity) {
+        table->capacity = table->capacity == 0 ? 64 : table->capacity * 2;
+        table->strings = (char**) realloc(table->strings, table->capacity * sizeof(char*));
+        if (table->strings == NULL) {
+            printf("Error: Memory allocation failed.\n");
+            exit(1);
+        }
+    }
+
+    char* copy = strndup(name, length);
+    if (copy == NULL) {
+        printf("Error: Memory allocation failed.\n");
+        exit(1);
+    }
+    table->strings[table->count] = copy;
+    table->buckets[slot] = table->count + 1;
+    return table->count++;
+}
+
+// frees every string in a name table and resets it to empty
+void freeNameTable(NameTable* table) {
+    for (uint32_t i = 0; i < table->count; i++) {
+        free(table->strings[i]);
+    }
+    free(table->strings);
+    free(table->buckets);
+    memset(table, 0, sizeof(NameTable));
+}
+
+// frees the shared name tables and arenas, only call once every database has been freed
+void freeCompactStorage() {
+    freeNameTable(&firstNames);
+    freeNameTable(&lastNames);
+    freeArena(&studentArena);
+    freeArena(&nodeArena);
+}
+
+// creates a student, or returns NULL if their ID can't be packed
+Student* createStudent(char* name, char* id, double gpa, int creditHours) {
+    uint64_t packedID;
+    if (!encodeID(id, &packedID)) {
+        printf("Error: ID %s must be at most %d digits or uppercase letters.\n", id, MAX_ID_LENGTH);
+        return NULL;
+    }
+
+    Student* newStudent = (Student*) arenaAlloc(&studentArena);
+
+    // first name is everything before the first space, last name everything after it
+    const char* space = strchr(name, ' ');
+    if (space == NULL) {
+        newStudent->firstName = internName(&firstNames, name, strlen(name));
+        newStudent->lastName = NO_LAST_NAME;
+    }
+    else {
+        newStudent->firstName = internName(&firstNames, name, space - name);
+        newStudent->lastName = internName(&lastNames, space + 1, strlen(space + 1));
+    }
+    newStudent->id = packedID;
+    newStudent->gpa = gpa;
+    newStudent->creditHours = creditHours;
+
+    return newStudent;
+}
+
+// free memory owned by a student (names stay in the shared tables)
+void freeStudent(Student* student) {
+    arenaFree(&studentArena, student);
+}
+
+// writes the student's full name into buffer and returns it
+const char* studentName(Student* student, char* buffer, size_t size) {
+    if (student->lastName == NO_LAST_NAME) {
+        snprintf(buffer, size, "%s", firstNames.strings[student->firstName]);
+    }
+    else {
+        snprintf(buffer, size, "%s %s", firstNames.strings[student->firstName], lastNames.strings[student->lastName]);
+    }
+    return buffer;
+}
+
+// writes the student's ID into buffer (MAX_ID_LENGTH + 1 chars) and returns it
+const char* studentID(Student* student, char* buffer) {
+    decodeID(student->id, buffer);
+    return buffer;
+}
+
+// converts an ID into a lookup key, returns false if no student can have it
+bool makeStudentKey(const char* id, StudentKey* key) {
+    return encodeID(id, key);
+}
+
+bool studentHasKey(Student* student, StudentKey key) {
+    return student->id == key;
+}
+#else
 Student* createStudent(char* name, char* id, double gpa, int creditHours) {
     Student* newStudent = (Student*) malloc(sizeof(Student));
     if (newStudent == NULL) {
@@ -102,11 +544,43 @@ Student* createStudent(char* name, char* id, double gpa, int creditHours) {
     return newStudent;
 }
 
+// free memory owned by a student
+void freeStudent(Student* student) {
+    free(student->name);
+    free(student->id);
+    free(student);
+}
+
+const char* studentName(Student* student, char* buffer, size_t size) {
+    (void) buffer;
+    (void) size;
+    return student->name;
+}
+
+const char* studentID(Student* student, char* buffer) {
+    (void) buffer;
+    return student->id;
+}
+
+bool makeStudentKey(const char* id, StudentKey* key) {
+    *key = id;
+    return true;
+}
+
+bool studentHasKey(Student* student, StudentKey key) {
+    return strcmp(student->id, key) == 0;
+}
+#endif
+
 
 // create new studentNode and returns pointer to it
 StudentNode* createStudentNode(Student* student) {
     // allocate memory
+#ifdef COMPACT_STUDENTS
+    StudentNode* newNode = (StudentNode*) arenaAlloc(&nodeArena);
+#else
     StudentNode* newNode = (StudentNode*) malloc(sizeof(StudentNode));
+#endif
 
     // check if allocation was succesful
     if (newNode == NULL) {
@@ -115,28 +589,89 @@ StudentNode* createStudentNode(Student* student) {
     }
 
     // initialize data
+#ifdef COMPACT_STUDENTS
+    newNode->student = arenaIndex(&studentArena, student);
+    newNode->next = 0;
+#else
     newNode->pStudent = student;
     newNode->pNext = NULL;
+#endif
 
     return newNode;
 }
 
+#ifdef COMPACT_STUDENTS
+// returns the student a node points at
+Student* nodeStudent(StudentNode* node) {
+    return (Student*) arenaSlot(&studentArena, node->student);
+}
+
+// returns the node after this one, or NULL at the end of the list
+StudentNode* nextNode(StudentNode* node) {
+    return (StudentNode*) arenaSlot(&nodeArena, node->next);
+}
+
+void setNextNode(StudentNode* node, StudentNode* next) {
+    node->next = arenaIndex(&nodeArena, next);
+}
+#else
+// returns the student a node points at
+Student* nodeStudent(StudentNode* node) {
+    return node->pStudent;
+}
+
+// returns the node after this one, or NULL at the end of the list
+StudentNode* nextNode(StudentNode* node) {
+    return node->pNext;
+}
+
+void setNextNode(StudentNode* node, StudentNode* next) {
+    node->pNext = next;
+}
+#endif
+
+// free a node created by createStudentNode
+void freeStudentNode(StudentNode* node) {
+#ifdef COMPACT_STUDENTS
+    arenaFree(&nodeArena, node);
+#else
+    free(node);
+#endif
+}
+
 void addStudent(Database* db, Student* student) {
+#ifdef PARALLEL_QUERIES
+    // append student to the store scanned by queries
+    if (db->studentCount == db->studentCapacity) {
+        db->studentCapacity = db->studentCapacity == 0 ? 64 : db->studentCapacity * 2;
+        db->pStudents = (Student**) realloc(db->pStudents, db->studentCapacity * sizeof(Student*));
+        if (db->pStudents == NULL) {
+            printf("Error: Memory allocation failed.\n");
+            exit(1);
+        }
+    }
+    db->pStudents[db->studentCount] = student;
+#endif
+    db->studentCount++;
+
     StudentNode* newNode = createStudentNode(student);
 
     // add student to ID list, sorted by ID
     db->pIDList = sortedInsert(db->pIDList, newNode, compareByID);
+    db->listVersions[ID_LIST]++;
 
     // add student to honor roll list, if their GPA is 3.5 or higher
     if (student->gpa >= 3.5) {
         newNode = createStudentNode(student);
         db->pHonorRollList = sortedInsert(db->pHonorRollList, newNode, compareByGPA);
+        db->listVersions[HONOR_ROLL_LIST]++;
     }
 
     // add student to the academic probation list, if GPA is below 2.0
     if (student->gpa < 2.0) {
         newNode = createStudentNode(student);
         db->pAcademicProbationList = sortedInsert(db->pAcademicProbationList, newNode, compareByGPA);
+        db->listVersions[ACADEMIC_PROBATION_LIST]++;
     }
 
     // add student to the appropriate class list, sorted by name based on credit hours
@@ -145,22 +680,30 @@ void addStudent(Database* db, Student* student) {
         // printf("Debug: student->name address: %p, length: %zu\n", student->name, strlen(student->name));
         // printf("Debug: student->id address: %p, length: %zu\n", student->id, strlen(student->id));
         db->pFreshmanList = sortedInsert(db->pFreshmanList, newNode, compareByName);
+        db->listVersions[FRESHMAN_LIST]++;
     } 
     else if (student->creditHours < 60) {
         // printf("Debug: student->name address: %p, length: %zu\n", student->name, strlen(student->name));
         // printf("Debug: student->id address: %p, length: %zu\n", student->id, strlen(student->id));
         db->pSophomoreList = sortedInsert(db->pSophomoreList, newNode, compareByName);
+        db->listVersions[SOPHOMORE_LIST]++;
     } 
     else if (student->creditHours < 90) {
         // printf("Debug: student->name address: %p, length: %zu\n", student->name, strlen(student->name));
         // printf("Debug: student->id address: %p, length: %zu\n", student->id, strlen(student->id));
         db->pJuniorList = sortedInsert(db->pJuniorList, newNode, compareByName);
+        db->listVersions[JUNIOR_LIST]++;
     } 
     else {
         // printf("Debug: student->name address: %p, length: %zu\n", student->name, strlen(student->name));
         // printf("Debug: student->id address: %p, length: %zu\n", student->id, strlen(student->id));
         db->pSeniorList = sortedInsert(db->pSeniorList, newNode, compareByName);
+        db->listVersions[SENIOR_LIST]++;
     }
+
+#ifdef CHECK_INVARIANTS
+    checkDatabaseInvariants(db);
+#endif
 }
 
 //typedef int (*CompareFunc)(Student*, Student*);
@@ -168,27 +711,31 @@ void addStudent(Database* db, Student* student) {
 // insert a new node into sorted linked list and return the new head of list
 StudentNode* sortedInsert(StudentNode* head, StudentNode* newNode, CompareFunc compare) {
     // if list emtpy 
-    if (head == NULL || compare(newNode->pStudent, head->pStudent) < 0) {
-        newNode->pNext = head;
+    if (head == NULL || compare(nodeStudent(newNode), nodeStudent(head)) < 0) {
+        setNextNode(newNode, head);
         return newNode;
     }
 
     // loop through list to find correct position for new node
     StudentNode* currentNode = head;
-    while (currentNode->pNext != NULL && compare(newNode->pStudent, currentNode->pNext->pStudent) >= 0) {
-        currentNode = currentNode->pNext;
+    while (nextNode(currentNode) != NULL && compare(nodeStudent(newNode), nodeStudent(nextNode(currentNode))) >= 0) {
+        currentNode = nextNode(currentNode);
     }
 
     // insert new node in correct position
-    newNode->pNext = currentNode->pNext;
-    currentNode->pNext = newNode;
+    setNextNode(newNode, nextNode(currentNode));
+    setNextNode(currentNode, newNode);
 
     return head; // return head of updated list
 }
 
 // compare two students by their ID and return a neg, pos, zero int
 int compareByID(Student* s1, Student* s2) {
+#ifdef COMPACT_STUDENTS
+    return (s1->id > s2->id) - (s1->id < s2->id);
+#else
     return strcmp(s1->id, s2->id);
+#endif
 }
 
 // compares two students by their GPA and returns an int
@@ -207,78 +754,196 @@ int compareByGPA(Student* s1, Student* s2) {
 
 // compare two students by their name and returns an int
 int compareByName(Student* s1, Student* s2) {
+#ifdef COMPACT_STUDENTS
+    // orders the same as strcmp on the full "first last" names
+    if (s1->firstName != s2->firstName) {
+        const unsigned char* a = (const unsigned char*) firstNames.strings[s1->firstName];
+        const unsigned char* b = (const unsigned char*) firstNames.strings[s2->firstName];
+        while (*a != '\0' && *a == *b) {
+            a++;
+            b++;
+        }
+        // if one first name is a prefix of the other, its full name continues with a space (or ends)
+        int c1 = *a != '\0' ? *a : (s1->lastName != NO_LAST_NAME ? ' ' : '\0');
+        int c2 = *b != '\0' ? *b : (s2->lastName != NO_LAST_NAME ? ' ' : '\0');
+        return c1 - c2;
+    }
+
+    if (s1->lastName == s2->lastName) {
+        return 0;
+    }
+    if (s1->lastName == NO_LAST_NAME) {
+        return -1;
+    }
+    if (s2->lastName == NO_LAST_NAME) {
+        return 1;
+    }
+    return strcmp(lastNames.strings[s1->lastName], lastNames.strings[s2->lastName]);
+#else
     return strcmp(s1->name, s2->name);
+#endif
 }
 
-// reads student info from a file and adds the student to the database
-void readStudentsFromFile(Database* db, char* filename) {
-    // open file for reading
-    FILE* file = fopen(filename, "r");
+// returns true if text is empty or only whitespace
+bool isBlankText(const char* text) {
+    while (*text != '\0') {
+        if (!isspace((unsigned char) *text)) {
+            return false;
+        }
+        text++;
+    }
+    return true;
+}
 
-    // check if file was opened succesfully
-    if (file == NULL) {
-        printf("Error: Unable to open file %s.\n", filename);
-        return;
+// parses one "name,id,gpa,credit hours" line into a new student
+// returns NULL if the line is blank or invalid, printing why for invalid lines
+Student* parseStudentLine(char* line, int lineNumber) {
+    if (isBlankText(line)) {
+        return NULL;
+    }
+
+    // split at every comma, so empty and extra fields are caught instead of skipped like strtok would
+    char* fields[4];
+    int fieldCount = 0;
+    char* field = line;
+    while (field != NULL) {
+        char* comma = strchr(field, ',');
+        if (comma != NULL) {
+            *comma = '\0';
+        }
+        if (fieldCount < 4) {
+            fields[fieldCount] = field;
+        }
+        fieldCount++;
+        field = comma != NULL ? comma + 1 : NULL;
+    }
+
+    if (fieldCount < 4) {
+        printf("Error: Line %d is missing fields, skipping it.\n", lineNumber);
+        return NULL;
     }
+    if (fieldCount > 4) {
+        printf("Error: Line %d has too many fields, skipping it.\n", lineNumber);
+        return NULL;
+    }
+
+    char* name = fields[0];
+    char* id = fields[1];
+    char* gpaText = fields[2];
+    char* creditHoursText = fields[3];
+    if (isBlankText(name) || isBlankText(id)) {
+        printf("Error: Line %d is missing a name or ID, skipping it.\n", lineNumber);
+        return NULL;
+    }
+
+    // numbers may only be followed by whitespace (e.g. the newline)
+    char* end;
+    double gpa = strtod(gpaText, &end);
+    if (end == gpaText || !isBlankText(end) || !isfinite(gpa)) {
+        printf("Error: Line %d has an invalid GPA, skipping it.\n", lineNumber);
+        return NULL;
+    }
+
+    long creditHours = strtol(creditHoursText, &end, 10);
+    if (end == creditHoursText || !isBlankText(end) || creditHours < INT_MIN || creditHours > INT_MAX) {
+        printf("Error: Line %d has invalid credit hours, skipping it.\n", lineNumber);
+        return NULL;
+    }
+
+    // compact mode can't store every ID, report it here where the line number is known
+    StudentKey key;
+    if (!makeStudentKey(id, &key)) {
+        printf("Error: Line %d has an ID that can't be stored, skipping it.\n", lineNumber);
+        return NULL;
+    }
+
+    return createStudent(name, id, gpa, (int) creditHours);
+}
+
+// returns true if buffer holds a whole line of file, otherwise discards the rest of the line
+// a full buffer is still a whole line if the file continues with the newline or ends
+bool readWholeLine(char* buffer, FILE* file) {
+    if (strchr(buffer, '\n') != NULL) {
+        return true;
+    }
+
+    int c = fgetc(file);
+    if (c == '\n' || c == EOF) {
+        return true;
+    }
+
+    while ((c = fgetc(file)) != '\n' && c != EOF);
+    return false;
+}
 
+// reads student info from an open file and adds the students to the database
+void readStudentsFromStream(Database* db, FILE* file) {
     char buffer[256];
+    int lineNumber = 1;
 
-    fgets(buffer, sizeof(buffer), file);
+    // skip the header
+    if (fgets(buffer, sizeof(buffer), file) != NULL) {
+        readWholeLine(buffer, file);
+    }
 
     // read each line of file
     while (fgets(buffer, sizeof(buffer), file) != NULL) {
-        // allocat memory for new student
-        Student* student = (Student*) malloc(sizeof(Student));
+        lineNumber++;
 
-        // check if allocation succesful
-        if (student == NULL) {
-            printf("Error: Memory allocation failed.\n");
-            fclose(file);
-            return;
+        if (!readWholeLine(buffer, file)) {
+            printf("Error: Line %d is too long, skipping it.\n", lineNumber);
+            continue;
         }
-        
-        // parse info from each line
-        char* token = strtok(buffer, ",");
-        student->name = strdup(token);
 
-        token = strtok(NULL, ",");
-        student->id = strdup(token);
-
-        token = strtok(NULL, ",");
-        student->gpa = atof(token);
+        Student* student = parseStudentLine(buffer, lineNumber);
+        if (student != NULL) {
+            addStudentFromFile(db, student);
+        }
+    }
+}
 
-        token = strtok(NULL, ",");
-        student->creditHours = atoi(token);
+// reads student info from a file and adds the student to the database
+void readStudentsFromFile(Database* db, char* filename) {
+    // open file for reading
+    FILE* file = fopen(filename, "r");
 
-        addStudentFromFile(db, student);
+    // check if file was opened succesfully
+    if (file == NULL) {
+        printf("Error: Unable to open file %s.\n", filename);
+        return;
     }
 
+    readStudentsFromStream(db, file);
     fclose(file); // close the file
 }
 
-void deleteIDList(StudentNode** studentList, const char* id) {
+// remove the node pointing at student from a list, without freeing the student
+// returns true if the student was in the list
+bool deleteIDList(StudentNode** studentList, Student* student) {
     if (*studentList == NULL) {
-        return;
+        return false;
     }
 
-    if (strcmp((*studentList)->pStudent->id, id) == 0) {
+    if (nodeStudent(*studentList) == student) {
         StudentNode* temp = *studentList;
-        *studentList = (*studentList)->pNext;
-        free(temp);
-        return;
+        *studentList = nextNode(*studentList);
+        freeStudentNode(temp);
+        return true;
     }
 
     StudentNode* prev = *studentList;
-    StudentNode* current = prev->pNext;
-    while (current != NULL && strcmp(current->pStudent->id, id) != 0) {
+    StudentNode* current = nextNode(prev);
+    while (current != NULL && nodeStudent(current) != student) {
         prev = current;
-        current = current->pNext;
+        current = nextNode(current);
     }
 
     if (current != NULL) {
-        prev->pNext = current->pNext;
-        free(current);
+        setNextNode(prev, nextNode(current));
+        freeStudentNode(current);
+        return true;
     }
+    return false;
 }
 
 
@@ -286,50 +951,72 @@ void deleteStudent(Database* db,  char* id) {
   StudentNode* prev = NULL;
   StudentNode* current = db->pIDList;
   bool found = false;
+  StudentKey key;
+
+  if (!makeStudentKey(id, &key)) {
+    current = NULL;
+  }
  
   while (current != NULL) {
-    if (strcmp(current->pStudent->id, id) == 0) {
+    if (studentHasKey(nodeStudent(current), key)) {
+      Student* student = nodeStudent(current);
       found = true;
      
-      deleteIDList(&(db->pHonorRollList), id);
-      deleteIDList(&(db->pAcademicProbationList), id);
-      deleteIDList(&(db->pFreshmanList), id);
-      deleteIDList(&(db->pSophomoreList), id);
-      deleteIDList(&(db->pJuniorList), id);
-      deleteIDList(&(db->pSeniorList), id);
+      // bump the version of every list the student was removed from
+      db->listVersions[HONOR_ROLL_LIST] += deleteIDList(&(db->pHonorRollList), student);
+      db->listVersions[ACADEMIC_PROBATION_LIST] += deleteIDList(&(db->pAcademicProbationList), student);
+      db->listVersions[FRESHMAN_LIST] += deleteIDList(&(db->pFreshmanList), student);
+      db->listVersions[SOPHOMORE_LIST] += deleteIDList(&(db->pSophomoreList), student);
+      db->listVersions[JUNIOR_LIST] += deleteIDList(&(db->pJuniorList), student);
+      db->listVersions[SENIOR_LIST] += deleteIDList(&(db->pSeniorList), student);
+      db->listVersions[ID_LIST]++;
+
+#ifdef PARALLEL_QUERIES
+      // remove from the student store, keeping insertion order
+      for (int i = 0; i < db->studentCount; i++) {
+        if (db->pStudents[i] == student) {
+          memmove(&db->pStudents[i], &db->pStudents[i + 1], (db->studentCount - i - 1) * sizeof(Student*));
+          break;
+        }
+      }
+#endif
+      db->studentCount--;
      
       if (prev == NULL) {
-        db->pIDList = current->pNext;
+        db->pIDList = nextNode(current);
       } 
       else {
-        prev->pNext = current->pNext;
+        setNextNode(prev, nextNode(current));
       }
      
-      free(current->pStudent->name);
-      free(current->pStudent->id);
-      free(current->pStudent);
-      free(current);
+      freeStudent(student);
+      freeStudentNode(current);
      
       break;
     }
     prev = current;
-    current = current->pNext;
+    current = nextNode(current);
   }
  
   if (!found) {
     printf("Sorry, there is no student in the db with the id %s.\n", id);
   }
+
+#ifdef CHECK_INVARIANTS
+  checkDatabaseInvariants(db);
+#endif
 }
 
 // free memory allocated for given list of students
-void freeList(StudentNode* list) {
+// every student is in the ID list, so only that list frees the students themselves
+void freeList(StudentNode* list, bool freeStudents) {
     // loop thru list and free memory for wach student & node
     while (list != NULL) {
-        StudentNode* next = list->pNext;
-        free(list->pStudent->name);
-        free(list->pStudent->id);
-        free(list->pStudent);
-        free(list);
+        StudentNode* next = nextNode(list);
+        if (freeStudents) {
+            freeStudent(nodeStudent(list));
+        }
+        freeStudentNode(list);
         list = next;
     }
 }
@@ -337,13 +1024,17 @@ void freeList(StudentNode* list) {
 // fress memory allocated for given database
 void freeDatabase(Database* db) {
     // free each list of students in database
-    freeList(db->pIDList);
-    freeList(db->pHonorRollList);
-    freeList(db->pAcademicProbationList);
-    freeList(db->pFreshmanList);
-    freeList(db->pSophomoreList);
-    freeList(db->pJuniorList);
-    freeList(db->pSeniorList);
+    freeList(db->pHonorRollList, false);
+    freeList(db->pAcademicProbationList, false);
+    freeList(db->pFreshmanList, false);
+    freeList(db->pSophomoreList, false);
+    freeList(db->pJuniorList, false);
+    freeList(db->pSeniorList, false);
+    freeList(db->pIDList, true);
+#ifdef PARALLEL_QUERIES
+    free(db->pStudents);
+#endif
+    freeQueryCache(&db->cache);
     // free the memory allocated for database itself
     free(db);
 }
@@ -352,45 +1043,555 @@ void freeDatabase(Database* db) {
 StudentNode* findAndRemove(StudentNode** pHead, char* id) {
     StudentNode* prev = NULL;
     StudentNode* current = *pHead;
+    StudentKey key;
+
+    if (!makeStudentKey(id, &key)) {
+        return NULL;
+    }
 
     // loop thru list to find the student with given id
     while (current != NULL) {
-        if (strcmp(current->pStudent->id, id) == 0) {
+        if (studentHasKey(nodeStudent(current), key)) {
             // if found, update list to remove
             if (prev != NULL) {
-                prev->pNext = current->pNext;
+                setNextNode(prev, nextNode(current));
             } 
             else {
-                *pHead = current->pNext;
+                *pHead = nextNode(current);
             }
-            current->pNext = NULL;
+            setNextNode(current, NULL);
             return current;
         }
 
         prev = current;
-        current = current->pNext;
+        current = nextNode(current);
     }
 
     return NULL;
 }
 
-void displayStudent(StudentNode* studentNode) {
-    if (studentNode == NULL) {
-        printf("There are no students matching that criteria.\n");
+#ifdef CHECK_INVARIANTS
+// stops the program, used when the database is found to be inconsistent
+void invariantFailed(const char* message, int list) {
+    fprintf(stderr, "Error: Database invariant broken in list %d: %s\n", list, message);
+    abort();
+}
+
+int comparePointers(const void* a, const void* b) {
+    uintptr_t x = (uintptr_t) *(Student* const*) a;
+    uintptr_t y = (uintptr_t) *(Student* const*) b;
+    return (x > y) - (x < y);
+}
+
+// returns true if the student belongs in the given list
+bool belongsInList(Student* student, ListIndex list) {
+    switch (list) {
+        case HONOR_ROLL_LIST:
+            return student->gpa >= 3.5;
+        case ACADEMIC_PROBATION_LIST:
+            return student->gpa < 2.0;
+        case FRESHMAN_LIST:
+            return student->creditHours < 30;
+        case SOPHOMORE_LIST:
+            return student->creditHours >= 30 && student->creditHours < 60;
+        case JUNIOR_LIST:
+            return student->creditHours >= 60 && student->creditHours < 90;
+        case SENIOR_LIST:
+            return student->creditHours >= 90;
+        default:
+            return true;
+    }
+}
+
+// aborts unless every list is sorted and holds exactly the students of the store that belong in it
+void checkDatabaseInvariants(Database* db) {
+    StudentNode* lists[LIST_COUNT] = {
+        db->pIDList, db->pHonorRollList, db->pAcademicProbationList,
+        db->pFreshmanList, db->pSophomoreList, db->pJuniorList, db->pSeniorList
+    };
+    CompareFunc orders[LIST_COUNT] = {
+        compareByID, compareByGPA, compareByGPA,
+        compareByName, compareByName, compareByName, compareByName
+    };
+
+    // sorted copy of the store so membership can be checked by binary search
+    size_t storeSize = db->studentCount * sizeof(Student*);
+    Student** store = (Student**) malloc(storeSize > 0 ? storeSize : 1);
+    Student** members = (Student**) malloc(storeSize > 0 ? storeSize : 1);
+    if (store == NULL || members == NULL) {
+        printf("Error: Memory allocation failed.\n");
+        exit(1);
+    }
+#ifdef PARALLEL_QUERIES
+    if (storeSize > 0) {
+        memcpy(store, db->pStudents, storeSize);
+    }
+#else
+    // without the store, the ID list is the record of every student
+    int stored = 0;
+    for (StudentNode* node = db->pIDList; node != NULL; node = nextNode(node)) {
+        if (stored == db->studentCount) {
+            invariantFailed("more nodes than students", ID_LIST);
+        }
+        store[stored++] = nodeStudent(node);
+    }
+    if (stored != db->studentCount) {
+        invariantFailed("student count doesn't match the ID list", ID_LIST);
+    }
+#endif
+    qsort(store, db->studentCount, sizeof(Student*), comparePointers);
+
+    for (int list = 0; list < LIST_COUNT; list++) {
+        int count = 0;
+        for (StudentNode* node = lists[list]; node != NULL; node = nextNode(node)) {
+            Student* student = nodeStudent(node);
+            if (count == db->studentCount) {
+                invariantFailed("more nodes than students", list);
+            }
+            if (!belongsInList(student, list)) {
+                invariantFailed("student doesn't belong in list", list);
+            }
+            if (nextNode(node) != NULL && orders[list](student, nodeStudent(nextNode(node))) > 0) {
+                invariantFailed("list is out of order", list);
+            }
+            if (bsearch(&student, store, db->studentCount, sizeof(Student*), comparePointers) == NULL) {
+                invariantFailed("student isn't in the store", list);
+            }
+            members[count++] = student;
+        }
+
+        // no student twice, and none missing
+        qsort(members, count, sizeof(Student*), comparePointers);
+        for (int i = 1; i < count; i++) {
+            if (members[i] == members[i - 1]) {
+                invariantFailed("student is in list twice", list);
+            }
+        }
+        int expected = 0;
+        for (int i = 0; i < db->studentCount; i++) {
+            expected += belongsInList(store[i], list);
+        }
+        if (count != expected) {
+            invariantFailed("student is missing from list", list);
+        }
+    }
+
+    free(store);
+    free(members);
+}
+#endif
+
+#ifdef PARALLEL_QUERIES
+#define QUERY_MORSEL_SIZE 16384
+#define MAX_QUERY_THREADS 64
+
+// number of threads used by runQuery, 0 means one per online cpu
+int queryThreadCount = 0;
+
+// work handed to the pool; worker 0 is always the calling thread
+typedef void (*PoolTask)(void* arg, int worker);
+
+// threads kept between queries so a query doesn't pay to start them
+// only one query runs at a time, the pool is shared by every database
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t taskReady;
+    pthread_cond_t taskDone;
+    pthread_t threads[MAX_QUERY_THREADS];       // indexed by worker, 0 is unused
+    unsigned long seenTask[MAX_QUERY_THREADS];  // last task each thread looked at
+    int threadCount;         // pool threads started, workers 1 to threadCount
+    PoolTask task;
+    void* taskArg;
+    int taskWorkers;         // workers running the current task, the caller included
+    int running;             // pool threads still working on the current task
+    unsigned long taskNumber;
+    bool stopping;
+} QueryPool;
+
+QueryPool queryPool = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .taskReady = PTHREAD_COND_INITIALIZER,
+    .taskDone = PTHREAD_COND_INITIALIZER
+};
+
+// waits for tasks and runs the ones meant for this worker, until stopQueryThreads
+void* runPoolThread(void* arg) {
+    int worker = (int) (intptr_t) arg;
+
+    pthread_mutex_lock(&queryPool.lock);
+    while (1) {
+        while (!queryPool.stopping && queryPool.seenTask[worker] == queryPool.taskNumber) {
+            pthread_cond_wait(&queryPool.taskReady, &queryPool.lock);
+        }
+        if (queryPool.stopping) {
+            break;
+        }
+        queryPool.seenTask[worker] = queryPool.taskNumber;
+
+        if (worker < queryPool.taskWorkers) {
+            PoolTask task = queryPool.task;
+            void* taskArg = queryPool.taskArg;
+            pthread_mutex_unlock(&queryPool.lock);
+            task(taskArg, worker);
+            pthread_mutex_lock(&queryPool.lock);
+
+            if (--queryPool.running == 0) {
+                pthread_cond_signal(&queryPool.taskDone);
+            }
+        }
+    }
+    pthread_mutex_unlock(&queryPool.lock);
+
+    return NULL;
+}
+
+// runs task on workers 0 to workers - 1 and returns once all of them are done, starting threads as needed
+void runOnPool(int workers, PoolTask task, void* arg) {
+    if (workers > 1) {
+        pthread_mutex_lock(&queryPool.lock);
+        while (queryPool.threadCount < workers - 1) {
+            int worker = ++queryPool.threadCount;
+            queryPool.seenTask[worker] = queryPool.taskNumber;
+            if (pthread_create(&queryPool.threads[worker], NULL, runPoolThread, (void*) (intptr_t) worker) != 0) {
+                printf("Error: Unable to start query thread.\n");
+                exit(1);
+            }
+        }
+
+        queryPool.task = task;
+        queryPool.taskArg = arg;
+        queryPool.taskWorkers = workers;
+        queryPool.running = workers - 1;
+        queryPool.taskNumber++;
+        pthread_cond_broadcast(&queryPool.taskReady);
+        pthread_mutex_unlock(&queryPool.lock);
+    }
+
+    task(arg, 0);
+
+    if (workers > 1) {
+        pthread_mutex_lock(&queryPool.lock);
+        while (queryPool.running > 0) {
+            pthread_cond_wait(&queryPool.taskDone, &queryPool.lock);
+        }
+        pthread_mutex_unlock(&queryPool.lock);
+    }
+}
+
+// joins the pool threads; the next query starts them again
+void stopQueryThreads() {
+    pthread_mutex_lock(&queryPool.lock);
+    queryPool.stopping = true;
+    pthread_cond_broadcast(&queryPool.taskReady);
+    pthread_mutex_unlock(&queryPool.lock);
+
+    for (int worker = 1; worker <= queryPool.threadCount; worker++) {
+        pthread_join(queryPool.threads[worker], NULL);
+    }
+    queryPool.threadCount = 0;
+    queryPool.stopping = false;
+}
+
+// state shared by all threads running one query
+typedef struct {
+    Database* db;
+    StudentPredicate predicate;
+    void* arg;
+    CompareFunc order;
+    atomic_long nextMorsel;  // start of the next morsel of the store to scan
+} QueryScan;
+
+typedef struct {
+    QueryScan* scan;
+    QueryResult partial;
+    int capacity;
+} QueryWorker;
+
+// one level of the final merge: adjacent pairs of sorted runs are merged into out,
+// and each pair is split between workersPerPair workers
+typedef struct {
+    QueryMatch* runs[MAX_QUERY_THREADS];
+    int counts[MAX_QUERY_THREADS];
+    int offsets[MAX_QUERY_THREADS];  // where each run starts in the merged result
+    int runCount;
+    int workersPerPair;
+    QueryMatch* out;
+    CompareFunc order;
+} QueryMerge;
+
+// orders matches by the query's compare function, then by position in the store
+int compareMatches(QueryMatch* a, QueryMatch* b, CompareFunc order) {
+    if (order != NULL) {
+        int result = order(a->student, b->student);
+        if (result != 0) {
+            return result;
+        }
+    }
+    return (a->position > b->position) - (a->position < b->position);
+}
+
+// merges sorted runs a and b into out
+void mergeMatches(QueryMatch* a, int aCount, QueryMatch* b, int bCount, QueryMatch* out, CompareFunc order) {
+    int i = 0;
+    int j = 0;
+    int k = 0;
+
+    while (i < aCount && j < bCount) {
+        if (compareMatches(&b[j], &a[i], order) < 0) {
+            out[k++] = b[j++];
+        }
+        else {
+            out[k++] = a[i++];
+        }
+    }
+    if (i < aCount) {
+        memcpy(&out[k], &a[i], (aCount - i) * sizeof(QueryMatch));
+        k += aCount - i;
+    }
+    if (j < bCount) {
+        memcpy(&out[k], &b[j], (bCount - j) * sizeof(QueryMatch));
+    }
+}
+
+// merge sorts matches, leaving the result in matches if inMatches is true and in temp (same size) otherwise
+// the halves are sorted into the other buffer and merged back, so nothing is copied after a merge
+void sortMatches(QueryMatch* matches, QueryMatch* temp, int count, bool inMatches, CompareFunc order) {
+    if (count < 2) {
+        if (count == 1 && !inMatches) {
+            temp[0] = matches[0];
+        }
+        return;
+    }
+
+    int half = count / 2;
+    sortMatches(matches, temp, half, !inMatches, order);
+    sortMatches(matches + half, temp + half, count - half, !inMatches, order);
+    if (inMatches) {
+        mergeMatches(temp, half, temp + half, count - half, matches, order);
+    }
+    else {
+        mergeMatches(matches, half, matches + half, count - half, temp, order);
+    }
+}
+
+// returns how many of the first position matches of the merge of a and b come from a
+// no two matches compare equal (position breaks ties), so this is a plain binary search
+int splitMatches(QueryMatch* a, int aCount, QueryMatch* b, int bCount, int position, CompareFunc order) {
+    int low = position > bCount ? position - bCount : 0;
+    int high = position < aCount ? position : aCount;
+
+    while (low < high) {
+        int fromA = low + (high - low) / 2;
+        if (compareMatches(&a[fromA], &b[position - fromA - 1], order) < 0) {
+            low = fromA + 1;
+        }
+        else {
+            high = fromA;
+        }
+    }
+    return low;
+}
+
+// merges this worker's share of one pair of runs; an unpaired last run is merged with an empty one
+void runMergeWorker(void* arg, int worker) {
+    QueryMerge* merge = (QueryMerge*) arg;
+    int pair = worker / merge->workersPerPair;
+    int part = worker % merge->workersPerPair;
+
+    QueryMatch* a = merge->runs[2 * pair];
+    int aCount = merge->counts[2 * pair];
+    QueryMatch* b = a + aCount;
+    int bCount = 0;
+    if (2 * pair + 1 < merge->runCount) {
+        b = merge->runs[2 * pair + 1];
+        bCount = merge->counts[2 * pair + 1];
+    }
+
+    // each part writes its own slice of the output
+    int total = aCount + bCount;
+    int start = (int) ((long) total * part / merge->workersPerPair);
+    int end = (int) ((long) total * (part + 1) / merge->workersPerPair);
+    int startA = splitMatches(a, aCount, b, bCount, start, merge->order);
+    int endA = splitMatches(a, aCount, b, bCount, end, merge->order);
+
+    mergeMatches(a + startA, endA - startA, b + (start - startA), (end - endA) - (start - startA),
+                 merge->out + merge->offsets[2 * pair] + start, merge->order);
+}
+
+// claims morsels of the store until none are left, collecting matches into the worker's partial result
+void runQueryWorker(void* arg, int index) {
+    QueryWorker* worker = &((QueryWorker*) arg)[index];
+    QueryScan* scan = worker->scan;
+    Database* db = scan->db;
+
+    while (1) {
+        long start = atomic_fetch_add(&scan->nextMorsel, QUERY_MORSEL_SIZE);
+        if (start >= db->studentCount) {
+            break;
+        }
+        long end = start + QUERY_MORSEL_SIZE < db->studentCount ? start + QUERY_MORSEL_SIZE : db->studentCount;
+
+        for (long i = start; i < end; i++) {
+            Student* student = db->pStudents[i];
+            if (!scan->predicate(student, scan->arg)) {
+                continue;
+            }
+
+            if (worker->partial.count == worker->capacity) {
+                worker->capacity = worker->capacity == 0 ? 256 : worker->capacity * 2;
+                worker->partial.matches = (QueryMatch*) realloc(worker->partial.matches, worker->capacity * sizeof(QueryMatch));
+                if (worker->partial.matches == NULL) {
+                    printf("Error: Memory allocation failed.\n");
+                    exit(1);
+                }
+            }
+            worker->partial.matches[worker->partial.count].student = student;
+            worker->partial.matches[worker->partial.count].position = (int) i;
+            worker->partial.count++;
+            worker->partial.gpaTotal += student->gpa;
+        }
+    }
+
+    // morsels are claimed in store order, so the partial result is already ordered by position
+    if (scan->order != NULL && worker->partial.count > 1) {
+        QueryMatch* temp = (QueryMatch*) malloc(worker->partial.count * sizeof(QueryMatch));
+        if (temp == NULL) {
+            printf("Error: Memory allocation failed.\n");
+            exit(1);
+        }
+        sortMatches(worker->partial.matches, temp, worker->partial.count, true, scan->order);
+        free(temp);
+    }
+}
+
+// scans every student in parallel and returns those matching predicate, sorted by order
+// (or by insertion order if order is NULL); ties keep insertion order like the sorted lists do
+QueryResult runQuery(Database* db, StudentPredicate predicate, void* arg, CompareFunc order) {
+    QueryScan scan;
+    scan.db = db;
+    scan.predicate = predicate;
+    scan.arg = arg;
+    scan.order = order;
+    atomic_init(&scan.nextMorsel, 0);
+
+    // use no more threads than there are morsels
+    int threadCount = queryThreadCount > 0 ? queryThreadCount : (int) sysconf(_SC_NPROCESSORS_ONLN);
+    int morselCount = (db->studentCount + QUERY_MORSEL_SIZE - 1) / QUERY_MORSEL_SIZE;
+    if (threadCount > MAX_QUERY_THREADS) {
+        threadCount = MAX_QUERY_THREADS;
+    }
+    if (threadCount > morselCount) {
+        threadCount = morselCount;
+    }
+    if (threadCount < 1) {
+        threadCount = 1;
+    }
+
+    QueryWorker workers[MAX_QUERY_THREADS];
+    for (int i = 0; i < threadCount; i++) {
+        workers[i].scan = &scan;
+        workers[i].partial.matches = NULL;
+        workers[i].partial.count = 0;
+        workers[i].partial.gpaTotal = 0.0;
+        workers[i].capacity = 0;
+    }
+
+    runOnPool(threadCount, runQueryWorker, workers);
+
+    // the sorted partial results become the runs of the merge, leaving out empty ones
+    QueryMerge merge;
+    QueryResult result = {NULL, 0, 0.0};
+    merge.runCount = 0;
+    merge.order = order;
+    for (int i = 0; i < threadCount; i++) {
+        result.gpaTotal += workers[i].partial.gpaTotal;
+        if (workers[i].partial.count == 0) {
+            continue;
+        }
+        merge.runs[merge.runCount] = workers[i].partial.matches;
+        merge.counts[merge.runCount] = workers[i].partial.count;
+        merge.offsets[merge.runCount] = result.count;
+        merge.runCount++;
+        result.count += workers[i].partial.count;
+    }
+    if (merge.runCount == 1) {
+        result.matches = merge.runs[0];
+    }
+    if (merge.runCount < 2) {
+        return result;
+    }
+
+    // merge runs pairwise, one level at a time on every worker, swapping between two buffers
+    QueryMatch* buffers[2];
+    buffers[0] = (QueryMatch*) malloc(result.count * sizeof(QueryMatch));
+    buffers[1] = merge.runCount > 2 ? (QueryMatch*) malloc(result.count * sizeof(QueryMatch)) : NULL;
+    if (buffers[0] == NULL || (merge.runCount > 2 && buffers[1] == NULL)) {
+        printf("Error: Memory allocation failed.\n");
+        exit(1);
+    }
+
+    for (int level = 0; merge.runCount > 1; level++) {
+        int pairs = (merge.runCount + 1) / 2;
+        merge.workersPerPair = threadCount / pairs > 0 ? threadCount / pairs : 1;
+        merge.out = buffers[level % 2];
+        runOnPool(pairs * merge.workersPerPair, runMergeWorker, &merge);
+
+        // the first level read the partial results, which are no longer needed
+        if (level == 0) {
+            for (int i = 0; i < merge.runCount; i++) {
+                free(merge.runs[i]);
+            }
+        }
+
+        for (int pair = 0; pair < pairs; pair++) {
+            int count = merge.counts[2 * pair];
+            if (2 * pair + 1 < merge.runCount) {
+                count += merge.counts[2 * pair + 1];
+            }
+            merge.offsets[pair] = merge.offsets[2 * pair];
+            merge.runs[pair] = merge.out + merge.offsets[pair];
+            merge.counts[pair] = count;
+        }
+        merge.runCount = pairs;
+    }
+
+    result.matches = merge.out;
+    free(merge.out == buffers[0] ? buffers[1] : buffers[0]);
+    return result;
+}
+
+void freeQueryResult(QueryResult* result) {
+    free(result->matches);
+    result->matches = NULL;
+    result->count = 0;
+}
+#endif
+
+// writes a student's info to out
+void printStudent(FILE* out, Student* student) {
+    if (student == NULL) {
+        fprintf(out, "There are no students matching that criteria.\n");
         return;
     }
 
-    Student* student = studentNode->pStudent;
+    char name[NAME_BUFFER_LENGTH];
+    char id[MAX_ID_LENGTH + 1];
+    const char* studentNameText = studentName(student, name, sizeof(name));
+    const char* studentIDText = studentID(student, id);
 
-    if (student == NULL || student->name == NULL || student->id == NULL) {
-        printf("Invalid student data.\n");
+    if (studentNameText == NULL || studentIDText == NULL) {
+        fprintf(out, "Invalid student data.\n");
         return;
     }
 
-    printf("%s: \n", student->name);
-    printf("    ID - %s\n", student->id);
-    printf("    GPA - %.2f\n", student->gpa);
-    printf("    Credit Hours - %d\n", student->creditHours);
+    fprintf(out, "%s: \n", studentNameText);
+    fprintf(out, "    ID - %s\n", studentIDText);
+    fprintf(out, "    GPA - %.2f\n", student->gpa);
+    fprintf(out, "    Credit Hours - %d\n", student->creditHours);
+}
+
+void displayStudent(Student* student) {
+    printStudent(stdout, student);
 }
 
 // create new student from user input
@@ -538,9 +1739,9 @@ void displayHead(Database* db) {
     int displayed = 0;
 
     while (current != NULL && count < 10) {
-        displayStudent(current->pStudent);
+        displayStudent(nodeStudent(current));
         displayed = 1;
-        current = current->pNext;
+        current = nextNode(current);
         count++;
     }
     if (!displayed) {
@@ -548,109 +1749,196 @@ void displayHead(Database* db) {
     }
 }
 
-// display all student on honor roll, sorted by gpa
-void displayHonorRoll(Database* db) {
-    StudentNode* current = db->pHonorRollList;
-    int displayed = 0;
+// unlinks entry from the cache's least recently used order
+void unlinkCacheEntry(QueryCache* cache, CacheEntry* entry) {
+    if (entry->pPrev != NULL) {
+        entry->pPrev->pNext = entry->pNext;
+    }
+    else {
+        cache->pMostRecent = entry->pNext;
+    }
 
-    while (current != NULL) {
-        displayStudent(current->pStudent);
-        displayed = 1;
-        current = current->pNext;
+    if (entry->pNext != NULL) {
+        entry->pNext->pPrev = entry->pPrev;
+    }
+    else {
+        cache->pLeastRecent = entry->pPrev;
     }
+    entry->pPrev = NULL;
+    entry->pNext = NULL;
+}
 
-    if (!displayed) {
-        printf("There are no students matching that criteria.\n");
+// makes entry the most recently used one
+void pushCacheEntry(QueryCache* cache, CacheEntry* entry) {
+    entry->pPrev = NULL;
+    entry->pNext = cache->pMostRecent;
+    if (cache->pMostRecent != NULL) {
+        cache->pMostRecent->pPrev = entry;
     }
+    else {
+        cache->pLeastRecent = entry;
+    }
+    cache->pMostRecent = entry;
 }
 
-// diplays all freshmam student, sorted by name
-void displayAcademicProbation(Database* db) {
-    StudentNode* current = db->pAcademicProbationList;
-    int displayed = 0;
-    while (current != NULL) {
-        displayStudent(current->pStudent);
-        displayed = 1;
-        current = current->pNext;
+// removes an entry from the cache and frees it
+void evictCacheEntry(QueryCache* cache, CacheEntry* entry) {
+    unlinkCacheEntry(cache, entry);
+    cache->entries[entry->list] = NULL;
+    cache->bytesUsed -= entry->length;
+    free(entry->output);
+    free(entry);
+}
+
+// sets how many bytes of output the cache may hold, evicting the least recently used entries to fit
+void setCacheBudget(Database* db, size_t bytes) {
+    QueryCache* cache = &db->cache;
+    cache->byteBudget = bytes;
+    while (cache->bytesUsed > cache->byteBudget && cache->pLeastRecent != NULL) {
+        evictCacheEntry(cache, cache->pLeastRecent);
     }
+}
 
-    if (!displayed) {
-        printf("There are no students matching that criteria.\n");
+void freeQueryCache(QueryCache* cache) {
+    while (cache->pLeastRecent != NULL) {
+        evictCacheEntry(cache, cache->pLeastRecent);
     }
 }
 
-// diplays all freshman students, sorted by name
-void displayFreshmen(Database* db) {
-    StudentNode* current = db->pFreshmanList;
+// returns the head of a list and the credit hours a student must have to be displayed from it
+StudentNode* getList(Database* db, ListIndex list, int* minHours, int* maxHours) {
+    *minHours = INT_MIN;
+    *maxHours = INT_MAX;
+
+    switch (list) {
+        case ID_LIST:
+            return db->pIDList;
+        case HONOR_ROLL_LIST:
+            return db->pHonorRollList;
+        case ACADEMIC_PROBATION_LIST:
+            return db->pAcademicProbationList;
+        case FRESHMAN_LIST:
+            *minHours = 0;
+            *maxHours = 29;
+            return db->pFreshmanList;
+        case SOPHOMORE_LIST:
+            *minHours = 30;
+            *maxHours = 59;
+            return db->pSophomoreList;
+        case JUNIOR_LIST:
+            *minHours = 60;
+            *maxHours = 89;
+            return db->pJuniorList;
+        case SENIOR_LIST:
+            *minHours = 90;
+            return db->pSeniorList;
+        default:
+            return NULL;
+    }
+}
+
+// writes every student in a list to out, in list order
+void renderList(FILE* out, Database* db, ListIndex list) {
+    int minHours;
+    int maxHours;
+    StudentNode* current = getList(db, list, &minHours, &maxHours);
     int displayed = 0;
 
     while (current != NULL) {
-        Student* student = current->pStudent;
-
-        if (student->creditHours >= 0 && student->creditHours < 30) {
-            displayStudent(student);
+        Student* student = nodeStudent(current);
+        if (student != NULL && student->creditHours >= minHours && student->creditHours <= maxHours) {
+            printStudent(out, student);
             displayed = 1;
         }
-        current = current->pNext;
+        current = nextNode(current);
     }
+
     if (!displayed) {
-        printf("There are no students matching that criteria.\n");
+        fprintf(out, "There are no students matching that criteria.\n");
     }
 }
 
-// diplays all sophmore students, sorted by name
-void displaySophomores(Database* db) {
-    StudentNode* current = db->pSophomoreList;
-    int displayed = 0;
+// displays a list, reusing its rendered output if the list hasn't changed since
+void displayList(Database* db, ListIndex list) {
+    QueryCache* cache = &db->cache;
+    CacheEntry* entry = cache->entries[list];
 
-    while (current != NULL) {
-		Student* student = current->pStudent;
-        if (student->creditHours >= 30 && student->creditHours < 60) {
-			displayStudent(student);
-            displayed = 1;
-		}
-        current = current->pNext;
+    if (entry != NULL && entry->version == db->listVersions[list]) {
+        cache->hits++;
+        unlinkCacheEntry(cache, entry);
+        pushCacheEntry(cache, entry);
+        fwrite(entry->output, 1, entry->length, stdout);
+        return;
     }
-    if (!displayed) {
-        printf("There are no students matching that criteria.\n");
+    cache->misses++;
+
+    // drop the stale output, if any
+    if (entry != NULL) {
+        evictCacheEntry(cache, entry);
     }
-}
 
-void displayJuniors(Database* db) {
-    StudentNode* current = db->pJuniorList;
-    int displayed = 0;
+    char* output = NULL;
+    size_t length = 0;
+    FILE* out = open_memstream(&output, &length);
+    if (out == NULL) {
+        renderList(stdout, db, list);
+        return;
+    }
+    renderList(out, db, list);
+    fclose(out);
+    fwrite(output, 1, length, stdout);
 
-    while (current != NULL) {
-        Student* student = current->pStudent;
-        if (student != NULL && student->creditHours >= 60 && student->creditHours < 90) {
-        //     printf("Debug: student->name address: %p, length: %zu\n", student->name, strlen(student->name));
-        //     printf("Debug: student->id address: %p, length: %zu\n", student->id, strlen(student->id));
-            displayStudent(student);
-            displayed = 1;
-        }
-        current = current->pNext;
+    // keep the output only if it fits in the budget
+    if (length > cache->byteBudget) {
+        free(output);
+        return;
     }
-    if (!displayed) {
-        printf("There are no students matching that criteria.\n");
+    while (cache->bytesUsed + length > cache->byteBudget) {
+        evictCacheEntry(cache, cache->pLeastRecent);
+    }
+
+    entry = (CacheEntry*) malloc(sizeof(CacheEntry));
+    if (entry == NULL) {
+        free(output);
+        return;
     }
+    entry->list = list;
+    entry->version = db->listVersions[list];
+    entry->output = output;
+    entry->length = length;
+    pushCacheEntry(cache, entry);
+    cache->entries[list] = entry;
+    cache->bytesUsed += length;
+}
+
+// display all student on honor roll, sorted by gpa
+void displayHonorRoll(Database* db) {
+    displayList(db, HONOR_ROLL_LIST);
+}
+
+// display all students on academic probation, sorted by gpa
+void displayAcademicProbation(Database* db) {
+    displayList(db, ACADEMIC_PROBATION_LIST);
+}
+
+// diplays all freshman students, sorted by name
+void displayFreshmen(Database* db) {
+    displayList(db, FRESHMAN_LIST);
+}
+
+// diplays all sophmore students, sorted by name
+void displaySophomores(Database* db) {
+    displayList(db, SOPHOMORE_LIST);
+}
+
+// diplays all junior students, sorted by name
+void displayJuniors(Database* db) {
+    displayList(db, JUNIOR_LIST);
 }
 
 // diplays all senior students, sorted by name
 void displaySeniors(Database* db) {
-    StudentNode* current = db->pSeniorList;
-    int displayed = 0;
-
-    while (current != NULL) {
-        Student* student = current->pStudent;
-		if (student->creditHours >= 90) {
-			displayStudent(student);
-            displayed = 1;
-		}
-        current = current->pNext;
-    }
-    if (!displayed) {
-        printf("There are no students matching that criteria.\n");
-    }
+    displayList(db, SENIOR_LIST);
 }
 
 // display the student info with a given ID
@@ -661,13 +1949,18 @@ void displayStudentByID(Database* db) {
     clearInputBuffer(); // clear the input buffer
 
     StudentNode* current = db->pIDList;
+    StudentKey key;
+
+    if (!makeStudentKey(id, &key)) {
+        current = NULL;
+    }
 
     while (current != NULL) {
-        if (strcmp(current->pStudent->id, id) == 0) {
-            displayStudent(current->pStudent);
+        if (studentHasKey(nodeStudent(current), key)) {
+            displayStudent(nodeStudent(current));
             return;
         }
-        current = current->pNext;
+        current = nextNode(current);
     }
 
     printf("Sorry, there is no student in the database with the ID %s.\n", id);
@@ -675,7 +1968,9 @@ void displayStudentByID(Database* db) {
 
 
 bool isEmptyStudent(Student* student) {
-    return strlen(student->name) == 0 && strlen(student->id) == 0 && student->gpa == 0.0 && student->creditHours == 0;
+    char name[NAME_BUFFER_LENGTH];
+    char id[MAX_ID_LENGTH + 1];
+    return strlen(studentName(student, name, sizeof(name))) == 0 && strlen(studentID(student, id)) == 0 && student->gpa == 0.0 && student->creditHours == 0;
 }
 
 // adds a student to the database when reading from a file
@@ -683,9 +1978,14 @@ void addStudentFromFile(Database* db, Student* student) {
     if (!isEmptyStudent(student)) {
         addStudent(db, student);
     }
+    else {
+        freeStudent(student);
+    }
 }
 
 /// ------------------ MAIN ------------------ ///
+// the benchmark and test drivers include this file with STUDENT_DATABASE_NO_MAIN defined
+#ifndef STUDENT_DATABASE_NO_MAIN
 int main() {
     printf("CS 211, Spring 2023\n");
     printf("Program 4: Database of Students\n\n");
@@ -717,9 +2017,13 @@ int main() {
 	}
     // free the allocated memory
     freeDatabase(db);
+#ifdef COMPACT_STUDENTS
+    freeCompactStorage();
+#endif
 
     return 0;
 }
+#endif
 
 
 // printf("There are no students matching that criteria.\n\n");
@@ -0,0 +1,152 @@
+/*------------------------------------------- 
+Query Executor Scaling Benchmark
+Build: gcc -O2 -pthread -o query_benchmark query_benchmark.c
+       (the executor is only built with PARALLEL_QUERIES, which this file defines)
+Run:   ./query_benchmark [students] [max threads]
+------------------------------------------- */
+
+#define STUDENT_DATABASE_NO_MAIN
+#ifndef PARALLEL_QUERIES
+#define PARALLEL_QUERIES
+#endif
+#include "main.c"
+
+#include <time.h>
+
+// predicate with enough work per student that the scan is compute bound
+bool isHeavyMatch(Student* student, void* arg) {
+    (void) arg;
+    double x = student->gpa;
+    for (int i = 0; i < 20; i++) {
+        x = x * 1.0000001 + 0.5;
+    }
+    return x > 14.0 && student->creditHours > 60;
+}
+
+bool isOnHonorRoll(Student* student, void* arg) {
+    (void) arg;
+    return student->gpa >= 3.5;
+}
+
+double currentSeconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+// fills the student store directly, since building the sorted lists for millions of students takes hours
+void fillStore(Database* db, int count) {
+    const char* digits = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+    char id[MAX_ID_LENGTH + 1];
+    char name[32];
+
+    db->pStudents = (Student**) malloc(count * sizeof(Student*));
+    if (db->pStudents == NULL) {
+        printf("Error: Memory allocation failed.\n");
+        exit(1);
+    }
+    db->studentCapacity = count;
+
+    srand(1);
+    for (int i = 0; i < count; i++) {
+        for (int j = 0; j < MAX_ID_LENGTH; j++) {
+            id[j] = digits[rand() % 36];
+        }
+        id[MAX_ID_LENGTH] = '\0';
+        snprintf(name, sizeof(name), "First%d Last%d", rand() % 500, rand() % 500);
+        db->pStudents[db->studentCount++] = createStudent(name, id, (rand() % 401) / 100.0, rand() % 130);
+    }
+}
+
+// returns true if both results hold the same students in the same order
+bool sameResult(QueryResult* a, QueryResult* b) {
+    if (a->count != b->count) {
+        return false;
+    }
+    for (int i = 0; i < a->count; i++) {
+        if (a->matches[i].position != b->matches[i].position) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// returns true if the result is sorted by order, with ties in store order
+bool isSortedResult(QueryResult* result, CompareFunc order) {
+    for (int i = 1; i < result->count; i++) {
+        if (compareMatches(&result->matches[i - 1], &result->matches[i], order) >= 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// runs one query at 1, 2, 4, ... threads up to maxThreads and prints the speedup over one thread
+void benchmarkQuery(Database* db, const char* label, StudentPredicate predicate, CompareFunc order, int maxThreads) {
+    QueryResult reference = {NULL, 0, 0.0};
+    double baseSeconds = 0.0;
+
+    int threads = 1;
+    while (1) {
+        queryThreadCount = threads;
+        double start = currentSeconds();
+        QueryResult result = runQuery(db, predicate, NULL, order);
+        double seconds = currentSeconds() - start;
+
+        if (threads == 1) {
+            if (!isSortedResult(&result, order)) {
+                printf("Error: %s returned its matches out of order.\n", label);
+                exit(1);
+            }
+            reference = result;
+            baseSeconds = seconds;
+        }
+        else {
+            if (!sameResult(&reference, &result)) {
+                printf("Error: %s gave different results with %d threads.\n", label, threads);
+                exit(1);
+            }
+            freeQueryResult(&result);
+        }
+
+        printf("%-20s threads %3d  matches %9d  %8.3fs  speedup %5.2fx\n", label, threads, reference.count, seconds, baseSeconds / seconds);
+
+        if (threads == maxThreads) {
+            break;
+        }
+        threads = threads * 2 < maxThreads ? threads * 2 : maxThreads;
+    }
+
+    freeQueryResult(&reference);
+}
+
+int main(int argc, char** argv) {
+    int count = argc > 1 ? atoi(argv[1]) : 10000000;
+    int maxThreads = argc > 2 ? atoi(argv[2]) : (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (maxThreads > MAX_QUERY_THREADS) {
+        maxThreads = MAX_QUERY_THREADS;
+    }
+    if (count < 1 || maxThreads < 1) {
+        printf("Usage: %s [students] [max threads]\n", argv[0]);
+        return 1;
+    }
+
+    Database* db = initDatabase();
+    fillStore(db, count);
+    printf("%d students, up to %d threads\n", count, maxThreads);
+
+    benchmarkQuery(db, "predicate scan", isHeavyMatch, NULL, maxThreads);
+    benchmarkQuery(db, "honor roll by GPA", isOnHonorRoll, compareByGPA, maxThreads);
+
+    // the students were never added to the lists, so free them from the store
+    for (int i = 0; i < db->studentCount; i++) {
+        freeStudent(db->pStudents[i]);
+    }
+    db->studentCount = 0;
+    freeDatabase(db);
+    stopQueryThreads();
+#ifdef COMPACT_STUDENTS
+    freeCompactStorage();
+#endif
+    return 0;
+}
@@ -0,0 +1,47 @@
+#!/bin/sh
+# Builds the program, the fuzz harness, the differential test and the query benchmark with ASan,
+# UBSan and CHECK_INVARIANTS, in both the default and compact layouts, and runs them. The query benchmark
+# also runs under TSan, since it is the only driver that uses threads.
+# Usage: ./run_checks.sh [differential test operations] [seed]
+set -e
+
+OPERATIONS=${1:-1000000}
+SEED=${2:-1}
+CC=${CC:-gcc}
+FLAGS="-g -O1 -pthread -fsanitize=address,undefined -fno-sanitize-recover=all -DCHECK_INVARIANTS"
+BUILD=${BUILD:-_checks}
+
+mkdir -p "$BUILD"
+
+for MODE in default compact; do
+    EXTRA=""
+    if [ "$MODE" = compact ]; then
+        EXTRA="-DCOMPACT_STUDENTS"
+    fi
+
+    echo "== $MODE build"
+    $CC $FLAGS $EXTRA -o "$BUILD/student_database_$MODE" main.c
+    $CC $FLAGS $EXTRA -o "$BUILD/fuzz_parser_$MODE" fuzz_parser.c
+    $CC $FLAGS $EXTRA -o "$BUILD/differential_test_$MODE" differential_test.c
+
+    # every malformed line must be reported, and only the good one loaded
+    printf 'F\ncorpus/malformed-lines.csv\nR\n1\nX\n' | "$BUILD/student_database_$MODE" \
+        | grep -o "Error: Line [^.]*\.\|ID - .*" | diff corpus/malformed-lines.expected -
+    echo "loader rejected the malformed lines"
+
+    # replay the sample files and the corpus through the loader
+    "$BUILD/fuzz_parser_$MODE" small-list.csv students-100.csv corpus/*.csv
+    echo "fuzz harness replayed the sample files"
+
+    "$BUILD/differential_test_$MODE" "$OPERATIONS" "$SEED"
+
+    # a small store, so every thread count gets several morsels and must return the same result
+    $CC $FLAGS $EXTRA -o "$BUILD/query_benchmark_$MODE" query_benchmark.c
+    "$BUILD/query_benchmark_$MODE" 100000 4 > /dev/null
+    echo "queries gave the same results at 1 to 4 threads"
+done
+
+echo "== thread sanitizer"
+$CC -g -O1 -pthread -fsanitize=thread -o "$BUILD/query_benchmark_tsan" query_benchmark.c
+TSAN_OPTIONS=halt_on_error=1 "$BUILD/query_benchmark_tsan" 100000 4 > /dev/null
+echo "queries ran clean under TSan"